@@ -1,17 +1,90 @@
 #ifndef ACLNT_CHORD_H
 #define ACLNT_CHORD_H
 
-class rpccb_chord : public rpccb_msgbuf {
+// Free list for the objects stp_manager makes and frees once per RPC.
+// Classes opt in with operator new/delete and must be made with
+// plain new, not New.
+template<class T>
+class rpc_pool {
+  struct item { item *next; };
+  static item *head;
+  static u_int nfree;
+ public:
+  enum { MAXFREE = 1024 };
+  static void *get (size_t n) {
+    assert (n == sizeof (T));
+    if (!head)
+      return xmalloc (n);
+    item *i = head;
+    head = i->next;
+    nfree--;
+    return i;
+  }
+  static void put (void *p) {
+    if (nfree >= MAXFREE) {
+      xfree (p);
+      return;
+    }
+    item *i = static_cast<item *> (p);
+    i->next = head;
+    head = i;
+    nfree++;
+  }
+};
+template<class T> typename rpc_pool<T>::item *rpc_pool<T>::head;
+template<class T> u_int rpc_pool<T>::nfree;
+
+// Something rpc_timer_wheel can time out.  Destroying an armed timer
+// disarms it.
+class rpc_timer {
+  friend class rpc_timer_wheel;
+  tailq_entry<rpc_timer> tlink;
+  u_int64_t deadline;	// in wheel ticks
+  bool armed;
+ protected:
+  virtual void expired () = 0;
+ public:
+  rpc_timer () : deadline (0), armed (false) {}
+  virtual ~rpc_timer ();
+};
+
+// A hashed timing wheel for RPC retransmission timers.  All armed
+// timers share a single libasync timer, which runs only while some
+// timer is armed; timers fire up to a tick late.
+class rpc_timer_wheel {
+ public:
+  enum { TICK_MSEC = 10, NSLOTS = 1024 };
+
+ private:
+  tailq<rpc_timer, &rpc_timer::tlink> slots[NSLOTS];
+  u_int64_t base;	// usec at tick 0
+  u_int64_t now;	// last tick processed
+  size_t narmed;
+  timecb_t *tcb;
+
+  u_int64_t current_tick () const;
+  void tick ();
+  rpc_timer_wheel ();
+
+ public:
+  static rpc_timer_wheel &only ();
+  // (Re)arm t to expire sec/nsec from now.
+  void arm (rpc_timer *t, long sec, long nsec);
+  void disarm (rpc_timer *t);
+  size_t size () const { return narmed; }
+};
+
+class rpccb_chord : public rpccb_msgbuf, public rpc_timer {
  protected:
   rpccb_chord (ref<aclnt> c, xdrsuio &x, aclnt_cb _cb, callback<bool>::ptr u_tmo,
 	       void *out, xdrproc_t outproc, const sockaddr *d, 
 	       ptr<bool> del, ptr<void> in, int procno) :
     rpccb_msgbuf (c, x, wrap (this, &rpccb_chord::finish_cb, _cb, del), out, 
 		  outproc, d), 
-    utmo (u_tmo), deleted (del), c (c), procno (procno), in (in), s(*d) {};
+    utmo (u_tmo), deleted (del), c (c), procno (procno), in (in), s(*d),
+    tsoff (0) {};
 
   int rexmits;
-  timecb_t *tmo;
   long sec, nsec;
   callback<bool>::ptr utmo;
   ptr<bool> deleted;
@@ -19,9 +92,11 @@ class rpccb_chord : public rpccb_msgbuf {
   int procno;
   ptr<void> in;
   const sockaddr s;
+  size_t tsoff;		// offset of dorpc_arg::send_time in msgbuf
 
 private:
-  void timeout_cb (ptr<bool> del);
+  void expired ();
+  void set_send_time (u_int64_t t);
   void finish_cb (aclnt_cb cb, ptr<bool> del, clnt_stat err);
 
  public:
@@ -35,6 +110,9 @@ private:
 			     int procno,
 			     struct sockaddr *dest);
   void send (long sec, long nsec);
+
+  void *operator new (size_t n) { return rpc_pool<rpccb_chord>::get (n); }
+  void operator delete (void *p) { rpc_pool<rpccb_chord>::put (p); }
 };
 
 #endif
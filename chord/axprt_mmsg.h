@@ -0,0 +1,75 @@
+#ifndef _SFSNET_AXPRT_MMSG_H_
+#define _SFSNET_AXPRT_MMSG_H_
+
+#include "async.h"
+#include "arpc.h"
+
+#if defined(__linux__) && defined(MSG_WAITFORONE)
+# define HAVE_MMSG 1
+#endif /* __linux__ && MSG_WAITFORONE */
+
+// The datagram transport lsd uses for stp and for serving RPCs.
+// On Linux this is an axprt_mmsg unless chord.mmsg is 0; elsewhere
+// it is a plain axprt_dgram.
+ref<axprt> dgram_xprt_alloc (int fd);
+void dgram_xprt_stats (const strbuf &ob);
+
+#ifdef HAVE_MMSG
+// A datagram transport that moves packets VLEN at a time.  Readable
+// sockets are drained with recvmmsg; datagrams handed to sendv are
+// queued and go out in one sendmmsg at the end of the event loop
+// iteration (or as soon as VLEN are queued).  While the socket is
+// full, at most MAXQUEUE datagrams wait; further ones are dropped.
+class axprt_mmsg : public axprt {
+ public:
+  enum { VLEN = 32, MAXPKT = 65536, MAXROUNDS = 4, MAXQUEUE = 8 * VLEN };
+
+ private:
+  struct outpkt {
+    char *buf;
+    size_t len;
+    sockaddr_in dest;
+  };
+
+  int fd;
+  recvcb_t cb;
+  bool rbreak;
+
+  vec<outpkt> outq;
+  timecb_t *flushcb;
+  bool wblocked;
+
+  char *rbuf;
+  sockaddr_in rsa[VLEN];
+  iovec riov[VLEN];
+  mmsghdr rmsg[VLEN];
+
+  // Number of syscalls that moved i datagrams, for i in [0, VLEN].
+  static u_int64_t sendhist[VLEN + 1];
+  static u_int64_t recvhist[VLEN + 1];
+  static u_int64_t ndropped;
+
+  void input ();
+  void flush ();
+  void flush_cb ();
+  void schedule_flush ();
+
+ protected:
+  axprt_mmsg (int fd, int bufsize);
+  virtual ~axprt_mmsg ();
+
+ public:
+  void sendv (const iovec *iov, int cnt, const sockaddr *sa);
+  void setrcb (recvcb_t c);
+  void recvbreak () { rbreak = true; }
+  void poll ();
+  int getreadfd () { return fd; }
+  int getwritefd () { return fd; }
+
+  // bufsize sizes both socket buffers, as for axprt_dgram::alloc.
+  static ref<axprt_mmsg> alloc (int fd, int bufsize);
+  static void stats (const strbuf &ob);
+};
+#endif /* HAVE_MMSG */
+
+#endif /* _SFSNET_AXPRT_MMSG_H_ */
@@ -53,6 +53,7 @@ class locationtable;
 class rpc_manager;
 class finger_table;
 struct user_args;
+struct Coord;
 
 typedef vec<ptr<location> > route;
 class route_iterator;
@@ -76,6 +77,22 @@ strbuf_cat (const strbuf &sb, chordstat status)
   return rpc_print (sb, status, 0, NULL, NULL);
 }
 
+// Gathers the replies to the calls of a TRANSPORTPROC_DORPC_BATCH
+// and sends them once all are in.
+struct batch_reply : public virtual refcount {
+  svccb *sbp;
+  dorpc_batch_res res;
+  u_int outstanding;
+
+  batch_reply (svccb *s, u_int n) : sbp (s), outstanding (n)
+    { res.results.setsize (n); }
+  void set (u_int i, const dorpc_res &r) {
+    res.results[i] = r;
+    if (!--outstanding)
+      sbp->reply (&res);
+  }
+};
+
 struct user_args {
   //info about the RPC
   void *args;
@@ -88,22 +105,35 @@ struct user_args {
   //info about the vnode that will reply
   ptr<location> me_;
 
+  // set if this call came as part of a batch
+  dorpc_arg *targ;
+  ptr<batch_reply> batch;
+  u_int batchidx;
+
   user_args (svccb *s, void *a, const rpc_program *pr, int p, u_int64_t st) : 
     args (a), procno (p), sbp (s), prog (pr), send_time (st), 
-    init_time (getusec()) {};
+    init_time (getusec()), targ (NULL), batchidx (0) {};
 
   void *getvoidarg () { return args; };
   const void *getvoidarg () const { return args; };
   template<class T> T *getarg () { return static_cast<T *> (args); };
   template<class T> const T *getarg () const {return static_cast<T *> (args);};
   
-  void reject (auth_stat s) {sbp->reject (s); delete this; }
-  void reject (accept_stat s) {sbp->reject (s); delete this; }
+  void reject (auth_stat s) {
+    if (batch) batch->set (batchidx, dorpc_res (DORPC_NOHANDLER));
+    else sbp->reject (s);
+    delete this;
+  }
+  void reject (accept_stat s) {
+    if (batch) batch->set (batchidx, dorpc_res (DORPC_NOHANDLER));
+    else sbp->reject (s);
+    delete this;
+  }
   void reply (void *res);
   void replyref (const int &res);
   
   dorpc_arg * transport_header () 
-    { return sbp->Xtmpl getarg<dorpc_arg> (); };
+    { return targ ? targ : sbp->Xtmpl getarg<dorpc_arg> (); };
 
   void fill_from (chord_node *from);
   
@@ -151,6 +181,15 @@ class vnode : public virtual refcount {
   virtual void find_successor (const chordID &x, cbroute_t cb) = 0;
   virtual void find_succlist (const chordID &x, u_long m, cbroute_t cb,
 			      ptr<chordID> guess = NULL) = 0;
+  // Forget what lookups have learned about who is responsible for x,
+  // e.g. after its supposed owner did not have it.
+  virtual void invalidate_lookup (const chordID &x) = 0;
+  // Fill s with at least m successors of x if recent lookups already
+  // answer it.  Never calls out.  find_successor and find_succlist
+  // always route, so stabilization sees the ring as it is; callers
+  // that can live with a cached answer ask here first.
+  virtual bool cached_succlist (const chordID &x, u_long m,
+				vec<chord_node> &s) = 0;
 
   //upcall
   virtual void register_upcall (int progno, cbupcall_t cb) = 0;
@@ -176,6 +215,11 @@ class vnode : public virtual refcount {
   virtual vec<ptr<location> > preds () = 0;
 
   virtual ptr<location> closestpred (const chordID &x, const vec<chordID> &f) = 0;
+  // The next hop toward x for a node at from that asked us; it
+  // sends that hop, so any latency it weighs is from there.
+  virtual ptr<location> closestpred_for (const chordID &x,
+					 const vec<chordID> &f,
+					 const Coord &from) = 0;
 
   //RPC demux
   virtual void addHandler (const rpc_program &prog, cbdispatch_t cb) = 0;
@@ -200,6 +244,8 @@ class chord : public virtual refcount {
   vec<ptr<vnode> > vlist;
 
   void dispatch (ptr<asrv> s, svccb *sbp);
+  void dispatch_call (svccb *sbp, dorpc_arg *arg,
+		      ptr<batch_reply> b, u_int i);
 
   void tcpclient_cb (int srvfd);
   int initxprt (int myp, int type, int *fd);
@@ -33,6 +33,7 @@
 #include "route.h"
 #include "transport_prot.h"
 #include "coord.h"
+#include "lookup_cache.h"
 
 extern long outbytes;
 
@@ -64,8 +65,11 @@ class vnode_impl : public vnode {
   ptr<succ_list> successors;
   ptr<pred_list> predecessors;
   ptr<stabilize_manager> stabilizer;
+  lookup_cache lcache;
 
   virtual void dispatch (user_args *a);
+  void learn_succs (const chordID &x, const vec<chord_node> &s,
+		    chordstat status);
   
   void doroute (user_args *sbp, chord_testandfindarg *fa);
   void do_upcall (int upcall_prog, int upcall_proc,
@@ -117,7 +121,9 @@ class vnode_impl : public vnode {
 			   clnt_stat err);
   void find_successor_cb (chordID x, cbroute_t cb,
 			  vec<chord_node> s, route sp, chordstat status);
-  void get_succlist_cb (cbchordIDlist_t cb, chord_nodelistres *res,
+  void get_succlist_cb (chordID n, cbchordIDlist_t cb, chord_nodelistres *res,
+			clnt_stat err);
+  void get_predlist_cb (cbchordIDlist_t cb, chord_nodelistres *res,
 			clnt_stat err);
   void find_succlist_hop_cb (cbroute_t cb, route_iterator *ri, u_long m, bool done);
 
@@ -199,6 +205,8 @@ class vnode_impl : public vnode {
   virtual void find_successor (const chordID &x, cbroute_t cb);
   virtual void find_succlist (const chordID &x, u_long m, cbroute_t cb,
 			      ptr<chordID> guess = NULL);
+  void invalidate_lookup (const chordID &x);
+  bool cached_succlist (const chordID &x, u_long m, vec<chord_node> &s);
 
   //upcall
   void register_upcall (int progno, cbupcall_t cb);
@@ -221,6 +229,9 @@ class vnode_impl : public vnode {
   vec<ptr<location> > preds ();
 
   virtual ptr<location> closestpred (const chordID &x, const vec<chordID> &f);
+  virtual ptr<location> closestpred_for (const chordID &x,
+					 const vec<chordID> &f,
+					 const Coord &from);
   
   //RPC demux
   void addHandler (const rpc_program &prog, cbdispatch_t cb);
@@ -228,10 +239,33 @@ class vnode_impl : public vnode {
   cbdispatch_t getHandler (unsigned long prog); 
 };
 
+// With chord.lookup_alpha > 1, each hop also asks up to alpha - 1
+// other known nodes between the previous hop and the key, and goes
+// on from the first useful reply.
 class route_chord : public route_iterator {
+  // One hop's RPCs.  The first useful reply marks it done and the
+  // rest are ignored when they come back.
+  struct hop_round : public virtual refcount {
+    bool done;
+    int outstanding;
+    chordID primary;	// search_path.back () when the hop began
+    // An alternate's NOTINRANGE answer, kept until the rest report.
+    ptr<location> heldfrom;
+    chord_testandfindres *held;
+    hop_round (const chordID &p) : done (false), outstanding (0),
+				   primary (p), held (NULL) {}
+    ~hop_round () { if (held) delete held; }
+  };
+  u_int alpha;
+  ptr<hop_round> round;
+
   void make_hop (ptr<location> n);
-  void make_hop_cb (ptr<bool> del, chord_testandfindres *res, clnt_stat err);
+  void make_hop_cb (ptr<bool> del, ptr<hop_round> rd, ptr<location> n,
+		    chord_testandfindres *res, clnt_stat err);
+  void take_reply (ptr<hop_round> rd, ptr<location> n,
+		   chord_testandfindres *res);
   void send_hop_cb (bool done);
+  void note_failure (ptr<location> f);
 
  public:
   route_chord (ptr<vnode> vi, chordID xi);
@@ -8,29 +8,68 @@
 #include <misc_utils.h>
 #include "aclnt_chord.h"
 
-#define max_host_cache 64
-
 class location;
+struct hostinfo;
+
+struct lsdctl_rpcstatlist;
 
 /* Maintain statistics about outbound bandwidth usage */
 struct rpcstats {
-  str key;
-  size_t call_bytes;
-  size_t ncall;
-  size_t rexmit_bytes;
-  size_t nrexmit;
-  size_t reply_bytes;
-  size_t nreply;
+  // Service times go in log-spaced buckets, four per power of two
+  // usec, so a percentile is good to within about 20%.  The last
+  // bucket holds everything from 2^MAXLOG usec up.
+  enum { SUBBUCKETS = 4, MAXLOG = 31,
+	 NBUCKETS = SUBBUCKETS * (MAXLOG - 1) + 1 };
+
+  u_int64_t call_bytes;
+  u_int64_t ncall;
+  u_int64_t rexmit_bytes;
+  u_int64_t nrexmit;
+  u_int64_t reply_bytes;
+  u_int64_t nreply;
   u_int64_t latency_ewma; 
-  ihash_entry<rpcstats> h_link;
-
-  rpcstats (str k) :
-    key (k),
-    call_bytes (0), ncall (0),
-    rexmit_bytes (0), nrexmit (0),
-    reply_bytes (0), nreply (0),
-    latency_ewma (0)
-  {}
+  u_int64_t nlatency;
+  u_int64_t latency_max;
+  u_int64_t latency_hist[NBUCKETS];
+
+  static u_int bucket (u_int64_t usec);
+  static u_int64_t bucket_floor (u_int b);
+  void add_latency (u_int64_t usec);
+  // Upper bound of the bucket holding the pct'th percentile.
+  u_int64_t percentile (u_int pct) const;
+  bool used () const { return ncall || nrexmit || nreply || nlatency; }
+  void clear () { bzero (this, sizeof (*this)); }
+};
+
+// Statistics for every (program, procedure) seen, in a dense table.
+// Programs get a row the first time they are seen; procedures past
+// MAXPROCS, and programs past MAXPROGS, share the last entry/row.
+class rpcstats_table {
+ public:
+  enum { MAXPROGS = 16, MAXPROCS = 32 };
+
+ private:
+  int progs[MAXPROGS];
+  u_int nprogs;
+  rpcstats *rows[MAXPROGS];
+
+ public:
+  rpcstats *lookup (int progno, int procno) {
+    u_int i = 0;
+    while (i < nprogs && progs[i] != progno)
+      i++;
+    if (i == nprogs)
+      i = newrow (progno);
+    if (procno < 0 || procno >= MAXPROCS)
+      procno = MAXPROCS - 1;
+    return &rows[i][procno];
+  }
+  u_int newrow (int progno);
+  void clear ();
+  // Append an entry for each procedure with anything recorded.
+  void get (lsdctl_rpcstatlist &sl) const;
+
+  rpcstats_table () : nprogs (0) {}
 };
 
 void track_call (const rpc_program &prog, int procno, size_t b);
@@ -39,9 +78,34 @@ void track_rexmit (int progno, int procno, size_t b);
 void track_reply (const rpc_program &prog, int procno, size_t b);
 void track_proctime (const rpc_program &prog, int procno, u_int64_t l);
 
-extern ihash<str, rpcstats, &rpcstats::key, &rpcstats::h_link> rpc_stats_tab;
+extern rpcstats_table rpc_stats_tab;
 extern u_int64_t rpc_stats_lastclear;
 
+// Scheduling classes for the stp_manager send queues.  The class of
+// an RPC comes from its program and procedure unless the caller has
+// an rpc_class_scope open.
+enum rpc_class_t {
+  RPC_CLASS_INTERACTIVE = 0,	// lookups and client fetches
+  RPC_CLASS_NORMAL = 1,
+  RPC_CLASS_BULK = 2,		// repair and other background transfers
+  RPC_NCLASSES = 3
+};
+extern const char *rpc_class_name[RPC_NCLASSES];
+
+rpc_class_t rpc_class (int progno, int procno);
+void set_rpc_class (int progno, int procno, rpc_class_t c);
+
+// Whether stp_manager may batch calls to this procedure; only
+// procedures whose handlers answer at once should be.
+bool rpc_batchable (int progno, int procno);
+void set_rpc_batchable (int progno, int procno, bool b);
+
+struct rpc_class_scope {
+  int saved;
+  rpc_class_scope (rpc_class_t c);
+  ~rpc_class_scope ();
+};
+
 
 struct RPC_delay_args {
   ptr<location> l;
@@ -80,7 +144,11 @@ struct rpc_state {
   long seqno;
   bool in_window;
 
-  rpccb_chord *b;
+  rpccb_chord *b;	// NULL while waiting to be batched
+  hostinfo *h;	// stp_manager only
+  ptr<void> in;
+  const rpc_program *prog;
+  bool batched;
   int rexmits;
   u_int64_t sendtime;
   cbtmo_t cb_tmo;
@@ -92,6 +160,44 @@ struct rpc_state {
   rpc_state (ptr<location> from, ref<location> l, aclnt_cb c,  
 	     cbtmo_t cb_tmo,
 	     long s, int p, void *out);
+
+  void *operator new (size_t n) { return rpc_pool<rpc_state>::get (n); }
+  void operator delete (void *p) { rpc_pool<rpc_state>::put (p); }
+};
+
+// Calls to one host sent together as one TRANSPORTPROC_DORPC_BATCH.
+struct rpc_batch {
+  vec<rpc_state *> calls;
+  ref<dorpc_batch_arg> arg;
+  dorpc_batch_res res;
+
+  rpc_batch () : arg (New refcounted<dorpc_batch_arg> ()) {}
+};
+
+// One host's queue of RPCs of one class waiting for window.
+struct rpc_queue {
+  hostinfo *h;
+  int cls;
+  int num_qed;
+  bool ready;		// on stp_manager's ready list for cls
+  tailq<RPC_delay_args, &RPC_delay_args::q_link> Q;
+  tailq_entry<rpc_queue> readylink_;
+
+  rpc_queue () : h (NULL), cls (0), num_qed (0), ready (false) {}
+};
+
+// One of tcp_manager's pooled connections to a host.  Calls on it
+// hold a reference, so it outlives being closed.
+struct tcp_conn : public virtual refcount {
+  hostinfo *h;		// NULL once closed
+  int fd;
+  ptr<axprt_stream> xp;
+  u_int orpc;		// calls outstanding on this connection
+  u_int64_t connect_time;
+  u_int64_t last_used;
+  tailq_entry<tcp_conn> lrulink_;
+
+  tcp_conn (hostinfo *h, int fd);
 };
 
 // store latency information about a host.
@@ -102,8 +208,17 @@ struct hostinfo {
   u_int64_t maxdelay;
   float a_lat;
   float a_var;
-  int fd;
-  ptr<axprt_stream> xp;
+  // TCP-style smoothed round trip time and its mean deviation, in
+  // usec, from nrtt samples (RFC 6298 gains).
+  float srtt;
+  float rttvar;
+  u_int64_t nrtt;
+  u_int64_t nrexmit;	// stp first retransmissions
+  u_int64_t nspurious;	// of those, answered by the first send
+  vec<ref<tcp_conn> > conns;	// tcp_manager connections, if any
+  int nconnecting;
+  u_int nconnects;
+  u_int64_t closed_bytes;	// sent on connections since closed
   vec<RPC_delay_args *> connect_waiters;
   unsigned orpc; // tcp debugging (benjie)
 
@@ -114,6 +229,27 @@ struct hostinfo {
   timecb_t *bwcb;
   void update_bw ();
 
+  // stp_manager congestion state for this destination.
+  float cwind;
+  float cwind_ewma;
+  float ssthresh;
+  int inflight;		// RPCs counted against cwind
+  int npending;		// RPCs sent and not yet completed
+  int num_qed;
+  u_int64_t last_rpc;
+  ptr<aclnt> dgram_clnt;	// stp_manager's aclnt for this host
+  vec<rpc_state *> unbatched;	// sent, waiting for the batch to fill
+  size_t batchbytes;
+  timecb_t *batchcb;
+  bool nobatch;		// host predates TRANSPORTPROC_DORPC_BATCH
+  rpc_queue queues[RPC_NCLASSES];
+  tailq<rpc_state, &rpc_state::q_link> pending;
+  vec<float> timers;
+  vec<float> cwind_time;
+  vec<float> cwind_cwind;
+  // Hosts with RPCs queued or in flight must not be evicted.
+  bool busy () const { return npending || num_qed || orpc || nconnecting; }
+
   ihash_entry<hostinfo> hlink_;
   tailq_entry<hostinfo> lrulink_;
 
@@ -142,8 +278,9 @@ class rpc_manager {
   u_int64_t npending;
   ptr<u_int32_t> nrcv;
 
-  ptr<axprt_dgram> dgram_xprt;
+  ptr<axprt> dgram_xprt;
 
+  int max_hosts;	// soft cap; busy hosts are never evicted
   ihash<str, hostinfo, &hostinfo::key, &hostinfo::hlink_> hosts;
   tailq<hostinfo, &hostinfo::lrulink_> hostlru;
 
@@ -181,15 +318,45 @@ class rpc_manager {
   virtual ~rpc_manager () {};
 };
 
-// "dhashtcp" implementation.
+// "dhashtcp" implementation.  Connections are pooled: at most
+// max_conns in all, closed least recently used first once idle, and
+// reaped after idle_timeout seconds without calls.  Calls to a host
+// go on its least loaded connection; a host gets another, up to
+// conns_per_host, when that one already has conn_busy calls
+// outstanding.  Calls made while a connect is pending wait for it.
 class tcp_manager : public rpc_manager {
-  void doRPC_tcp_connect_cb (RPC_delay_args *args, int fd);
-  void doRPC_tcp_cleanup (ptr<aclnt> c, RPC_delay_args *args, clnt_stat err);
-  void send_RPC (RPC_delay_args *args);
+  int max_conns;
+  int conns_per_host;
+  int conn_busy;
+  int idle_timeout;
+
+  int nconns;
+  tailq<tcp_conn, &tcp_conn::lrulink_> connlru;
+  timecb_t *reapcb;
+
+  u_int64_t st;
+  u_int64_t nconnect;
+  u_int64_t nreconnect;	// connects to a host that had one before
+  u_int64_t nconnfail;
+  u_int64_t nclosed_idle;
+  u_int64_t nclosed_cap;
+  u_int64_t nclosed_eof;
+
+  void connect (hostinfo *h, const sockaddr_in &sa);
+  void doRPC_tcp_connect_cb (hostinfo *h, int fd);
+  void doRPC_tcp_cleanup (ptr<aclnt> c, ref<tcp_conn> tc, RPC_delay_args *args,
+			  clnt_stat err);
+  tcp_conn *pick_conn (hostinfo *h, bool *hadconns);
+  void send_RPC (RPC_delay_args *args, tcp_conn *tc);
   void send_RPC_ateofcb (RPC_delay_args *args);
+  void touch (tcp_conn *tc);
+  void close_conn (tcp_conn *tc);
+  void trim_conns ();
+  void reap ();
   void remove_host (hostinfo *h);
 
  public:
+  void stats (const strbuf &ob);
   long doRPC (ptr<location> from, ptr<location> l, 
 	      const rpc_program &prog, int procno,
 	      ptr<void> in, void *out, aclnt_cb cb, 
@@ -205,37 +372,52 @@ class tcp_manager : public rpc_manager {
   
   long doRPC_dead (ptr<location> l, const rpc_program &prog, int procno,
 		   ptr<void> in, void *out, aclnt_cb cb);
-  tcp_manager (ptr<u_int32_t> _nrcv) : rpc_manager (_nrcv) {}
-  ~tcp_manager () {}
+  tcp_manager (ptr<u_int32_t> _nrcv);
+  ~tcp_manager ();
 };
 
-// congestion control udp implementation.
+// congestion control udp implementation.  Each destination host has
+// its own window and per-class queues; a global cap bounds the sum of
+// the windows.  Classes share the cap by weight, with some of it
+// held back for interactive RPCs; within a class, hosts with queued
+// RPCs and room in their window are served round-robin.
 #define MAX_REXMIT 4
 #define MIN_RPC_FAILURE_TIMER 2
 class stp_manager : public rpc_manager {
   // state
-  vec<float> timers;
-  vec<float> cwind_time;
-  vec<float> cwind_cwind;
+  vec<float> qued_time;
   vec<long> qued_hist;
   vec<long> lat_inq;
 
   int seqno;
-  float cwind;
-  float cwind_ewma;
-  float ssthresh;
   float cwind_cum;
   int num_cwind_samples;
   int num_qed;
   
   int inflight;
+  int max_inflight;
+  int interactive_reserve;
+  int batch_usec;	// 0 disables batching
+  int batch_bytes;
+  u_int64_t nbatches;
+  u_int64_t nbatched;	// calls sent in batches
 
   u_int64_t st;
 
-  tailq<RPC_delay_args, &RPC_delay_args::q_link> Q;
-  tailq<rpc_state, &rpc_state::q_link> pending;
-
-  timecb_t *idle_timer;
+  // per-class scheduling state; pass is the stride scheduler's
+  // virtual time for the class.
+  struct class_state {
+    tailq<rpc_queue, &rpc_queue::readylink_> ready;
+    int weight;
+    u_int64_t pass;
+    int num_qed;
+    u_int64_t nsent;
+    u_int64_t wait_ewma;
+    u_int64_t wait_max;
+    class_state () : weight (1), pass (0), num_qed (0), nsent (0),
+		     wait_ewma (0), wait_max (0) {}
+  };
+  class_state classes[RPC_NCLASSES];
 
   ptr<tcp_manager> stream_rpcm;
 
@@ -243,16 +425,34 @@ class stp_manager : public rpc_manager {
   void doRPCcb (ref<aclnt> c, rpc_state *C, clnt_stat err);
   
   void ratecb ();
-  void remove_from_sentq (long acked_seqno);
-  void update_cwind (int acked);
+  void update_cwind (hostinfo *h, int acked);
   bool timeout (rpc_state *s);
-  void enqueue_rpc (RPC_delay_args *args);
+  bool timeout_call (rpc_state *s, bool &released);
+  void note_loss (rpc_state *s);
+  void reschedule (hostinfo *h);
+  void enqueue_rpc (rpc_queue *q, RPC_delay_args *args);
+  void schedule (rpc_queue *q);
+  int next_class ();
+  bool room_for_class (int c);
   void rpc_done (long seqno);
-  void reset_idle_timer ();
-  void idle ();
-  void setup_rexmit_timer (ptr<location> from, ptr<location> l, long *sec, long *nsec);
-  void timeout_cb (rpc_state *C);
-  bool room_in_window ();
+  void idle (hostinfo *h);
+  long send_rpc (hostinfo *h, ptr<location> from, ptr<location> l,
+		 const rpc_program &prog, int procno,
+		 ptr<void> in, void *out, aclnt_cb cb, cbtmo_t cb_tmo);
+  ref<aclnt> host_clnt (hostinfo *h, const rpc_program &prog,
+			ptr<location> l);
+  void send_one (rpc_state *C);
+  bool batchable (hostinfo *h, const rpc_program &prog, ptr<void> in);
+  void batch_add (rpc_state *C);
+  void batch_flush (hostinfo *h);
+  void batch_flushcb (hostinfo *h);
+  void doBatchcb (ref<aclnt> c, rpc_batch *bt, clnt_stat err);
+  bool batch_timeout (rpc_batch *bt);
+  void window_release (rpc_state *C);
+  float rto (hostinfo *h, ptr<location> from, ptr<location> l);
+  void setup_rexmit_timer (hostinfo *h, ptr<location> from, ptr<location> l,
+			   long *sec, long *nsec);
+  bool room_in_window (hostinfo *h);
  public:
   void stats (const strbuf &o);
 
@@ -11,6 +11,10 @@ class finger_table_pns : public finger_table {
 
   int fp;
 
+  // How far nearest_in_range looks past the real finger.
+  enum { MAXSCAN = 16 };
+
+  ptr<location> nearest_in_range (int i, ptr<location> f);
   void getsucclist_cb (int l, int r, vec<chord_node> succs, chordstat err);
 
 protected:
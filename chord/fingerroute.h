@@ -21,6 +21,7 @@ class fingerroute : public vnode_impl {
   
  private:
   bool gotfingers_; // fed locationtable with pred's fingers?
+  int nexthop_candidates_; // rank this many nodes per hop; 0 is off
 
   void init ();
   
@@ -31,6 +32,9 @@ class fingerroute : public vnode_impl {
   void first_fingers_cb (vec<chord_node> nlist, chordstat s);
   void get_fingers_cb (cbchordIDlist_t cb,
 		       chordID x, chord_nodelistres *res, clnt_stat err);
+  ptr<location> greedy_nexthop (const chordID &x, const vec<chordID> &failed);
+  ptr<location> rank_nexthop (const chordID &x, const vec<chordID> &failed,
+			      ptr<location> best, const Coord *from);
   
  public:
   static ref<vnode> produce_vnode (ref<chord> _chordnode, 
@@ -45,6 +49,9 @@ class fingerroute : public vnode_impl {
 
   void get_fingers (ptr<location> n, cbchordIDlist_t cb);
   virtual ptr<location> closestpred (const chordID &x, const vec<chordID> &f);
+  virtual ptr<location> closestpred_for (const chordID &x,
+					 const vec<chordID> &f,
+					 const Coord &from);
 };
 
 #endif /* _FINGERROUTE_H_ */
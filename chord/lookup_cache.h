@@ -0,0 +1,53 @@
+#ifndef _LOOKUP_CACHE_H_
+#define _LOOKUP_CACHE_H_
+
+#include <skiplist.h>
+#include <chord_types.h>
+
+// Successor lists learned from recent lookups and getsucclist
+// replies.  An entry with successors s[0..k] and lower bound lo
+// answers every key in (lo, s[k]]: a key in (s[i-1], s[i]] has
+// successors s[i..k].  Entries expire after ttl seconds and are
+// dropped when a node they name fails.
+class lookup_cache {
+  struct entry {
+    chordID succ;		// s[0], the sort key
+    chordID lo;
+    vec<chord_node> succs;
+    time_t added;
+    sklist_entry<entry> sortlink_;
+    tailq_entry<entry> lrulink_;
+  };
+
+  skiplist<entry, chordID, &entry::succ, &entry::sortlink_> entries;
+  tailq<entry, &entry::lrulink_> lru;
+  size_t nentries;
+  u_int max_entries;
+  time_t ttl;
+
+  u_int64_t nhits;
+  u_int64_t nmisses;
+  u_int64_t nexpired;
+  u_int64_t ninvalidated;
+
+  void remove (entry *e);
+  bool answer (entry *e, const chordID &x, u_long m, vec<chord_node> &s);
+
+ public:
+  // Fill s with at least m successors of x, if some fresh entry
+  // covers x.
+  bool lookup (const chordID &x, u_long m, vec<chord_node> &s);
+  // s are the successors of every key in (lo, s[0]].
+  void insert (const chordID &lo, const vec<chord_node> &s);
+  // Drop every entry naming n, or whose range holds x.
+  void invalidate_node (const chordID &n);
+  void invalidate_key (const chordID &x);
+
+  bool enabled () const { return max_entries > 0 && ttl > 0; }
+  void stats () const;
+
+  lookup_cache ();
+  ~lookup_cache ();
+};
+
+#endif /* _LOOKUP_CACHE_H_ */
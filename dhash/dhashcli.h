@@ -39,6 +39,7 @@ public:
     cb_ret callback;
 
     bool completed;
+    bool cached;	// succs came from the lookup cache
 
 
     void timemark () {
@@ -59,7 +60,8 @@ public:
       incoming_rpcs (0),
       nextsucc (0),
       callback (cb),
-      completed (false)
+      completed (false),
+      cached (false)
     {
       timemark ();
     }
@@ -77,10 +79,12 @@ public:
     u_int good;
 
     bool diskfull;
+    int options;
+    bool cached;	// succs came from the lookup cache
     
     sto_state (ref<dhash_block> b, cbinsert_path_t x) :
       block (b), cb (x), blk (NULL), out (0), good (0),
-      diskfull (false)
+      diskfull (false), options (0), cached (false)
     {
     }
   };
@@ -103,11 +107,17 @@ private:
 			   vec<chord_node> s, route path, chordstat err);
     
   void insert_lookup_cb (ref<dhash_block> block, cbinsert_path_t cb, int options, 
+			 bool cached,
 			 dhash_stat status, vec<chord_node> succs, route r);
+  void insert_lookup (ref<dhash_block> block, cbinsert_path_t cb,
+		      int options);
   void insert_store_cb (ref<sto_state> ss, u_int i, u_int64_t t, 
 			dhash_stat err, chordID id, bool present);
   
   void fetch_frag (ptr<rcv_state> rs, ptr<dhblock> block);
+  void retrieve_lookup (ptr<rcv_state> rs, ptr<chordID> guess,
+			bool usecache);
+  bool retrieve_relookup (ptr<rcv_state> rs);
 
   void retrieve_lookup_cb (ptr<rcv_state> rs, ptr<dhblock> block,
 			   vec<chord_node> succs, route r,
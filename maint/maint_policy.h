@@ -2,6 +2,7 @@
 #include <qhash.h>
 #include <dhash_types.h>
 #include <adb_prot.h>
+#include <id_utils.h>
 
 class adb;
 class merkle_tree; 
@@ -61,7 +62,28 @@ public:
 struct merkle_sync : public syncer {
 protected:
   merkle_sync (dhash_ctype c) : syncer (c) {}
+  void same_digest (ptr<aclnt> client, ptr<locationcc> who,
+      chordID rngmin, chordID rngmax,
+      ptr<merkle_tree> localtree,
+      bool *samemode, bool *sameshape,
+      cbb cb, CLOSURE);
+  // One iblt_syncer or merkle_syncer pass over the range.
+  void reconcile (ptr<aclnt> client, ptr<locationcc> who,
+      chordID rngmin, chordID rngmax,
+      ptr<merkle_tree> localtree,
+      missingfnc_t missing,
+      cbi cb, CLOSURE);
+  // keysonly: compare keys rather than nodes; see same_digest.
+  void walk (ptr<aclnt> client, ptr<locationcc> who,
+      chordID rngmin, chordID rngmax,
+      ptr<merkle_tree> localtree,
+      missingfnc_t missing,
+      bool keysonly,
+      cbv cb, CLOSURE);
 public:
+  // Keys per GETKEYS_BATCH page in a walk; 0 uses plain GETKEYS.
+  static u_int32_t keybatch;
+
   static ref<syncer> produce_syncer (dhash_ctype c);
   const rpc_program &sync_program ();
   void dispatch (ptr<merkle_tree> localtree, svccb *sbp);
@@ -71,14 +93,47 @@ public:
       missingfnc_t m,
       cbv cb, CLOSURE);
 };
-struct time_sync : public syncer {
+// Reconciles with IBLTs over the same program as merkle_sync, and
+// falls back to a merkle sync when the difference is too large.
+struct iblt_sync : public merkle_sync {
 protected:
-  time_sync (dhash_ctype c) : syncer (c) {}
+  iblt_sync (dhash_ctype c) : merkle_sync (c) {}
 public:
   static ref<syncer> produce_syncer (dhash_ctype c);
-  void dispatch (ptr<merkle_tree> localtree, svccb *sbp);
-  void sync_with (ptr<locationcc> who, ptr<merkle_tree> localtree,
+  void sync_with (ptr<locationcc> who,
+      chordID rngmin, chordID rngmax,
+      ptr<merkle_tree> localtree,
+      missingfnc_t m,
+      cbv cb, CLOSURE);
+};
+// Asks each neighbor only for the keys it has added since the last
+// sync with it, using a per-neighbor watermark on the neighbor's
+// clock.  Falls back to a merkle sync when there is no watermark for
+// the range, when the neighbor lacks the history, and every
+// full_sync_interval seconds, since removals are not reported.
+// Incremental syncs only learn what the neighbor has and we lack, so
+// they are used only when maintenance is pull-only (pullonly);
+// otherwise every sync is a merkle sync.
+struct time_sync : public merkle_sync {
+  struct watermark_t {
+    chordID rngmin;
+    chordID rngmax;
+    u_int32_t since;    // remote clock
+    u_int32_t lastfull; // local clock
+  };
+  qhash<chordID, watermark_t, hashID> watermarks;
+
+  static bool pullonly;
+  static const u_int32_t full_sync_interval;
+  static const u_int32_t watermark_slack;
+  static u_int32_t watermark (u_int32_t now);
+protected:
+  time_sync (dhash_ctype c) : merkle_sync (c) {}
+public:
+  static ref<syncer> produce_syncer (dhash_ctype c);
+  void sync_with (ptr<locationcc> who,
       chordID rngmin, chordID rngmax,
+      ptr<merkle_tree> localtree,
       missingfnc_t m,
       cbv cb, CLOSURE);
 };
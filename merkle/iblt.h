@@ -0,0 +1,79 @@
+#ifndef _IBLT_H_
+#define _IBLT_H_
+
+#include "merkle_hash.h"
+#include "merkle_sync_prot.h"
+
+class merkle_tree;
+
+// Invertible Bloom lookup table over merkle keys, as used for set
+// reconciliation in Eppstein et al., "What's the Difference?",
+// SIGCOMM 2011.  The table is split into NHASH equal sub-tables and
+// each key lands in one cell of each.  Subtracting two tables leaves
+// only the keys in the symmetric difference, which decode () peels
+// out as long as the table is large enough.
+class iblt {
+  vec<iblt_cell> cells;
+
+  void update (const merkle_hash &key, const merkle_hash &h, int32_t sign);
+  bool pure (u_int i) const;
+
+public:
+  enum { NHASH = 3 };
+
+  // h must be iblt_hash (key).
+  void insert (const merkle_hash &key, const merkle_hash &h) {
+    update (key, h, 1);
+  }
+  void remove (const merkle_hash &key, const merkle_hash &h) {
+    update (key, h, -1);
+  }
+  bool subtract (const iblt &o);
+  // Destructive.  Keys with positive sign (inserted here but not in
+  // the subtracted table) go in added; the others go in removed.
+  bool decode (vec<merkle_hash> &added, vec<merkle_hash> &removed);
+
+  u_int size () const { return cells.size (); }
+  void export_cells (rpc_vec<iblt_cell, RPC_INFINITY> &out,
+		     u_int start = 0, u_int n = 0) const;
+
+  // Round n up to a usable table size.
+  static u_int round_size (u_int n);
+
+  iblt (u_int ncells);
+  iblt (const rpc_vec<iblt_cell, RPC_INFINITY> &c,
+	u_int start = 0, u_int n = 0);
+};
+
+// A stack of small IBLTs, where stratum i holds the keys whose hash
+// has i trailing zero bits.  Used to estimate the size of a
+// difference before committing to an IBLT large enough to decode it.
+class strata_estimator {
+  vec<iblt> strata;
+
+public:
+  enum { NSTRATA = 16, STRATUM_CELLS = 30 };
+
+  void insert (const merkle_hash &key, const merkle_hash &h);
+  // Estimate the size of the difference with another estimator.
+  u_int estimate (const strata_estimator &o) const;
+  void export_cells (rpc_vec<iblt_cell, RPC_INFINITY> &out) const;
+  static bool valid_size (size_t ncells) {
+    return (ncells == NSTRATA * STRATUM_CELLS);
+  }
+
+  strata_estimator ();
+  strata_estimator (const rpc_vec<iblt_cell, RPC_INFINITY> &c);
+};
+
+// Hash used to place a key in the tables.
+void iblt_hash (const merkle_hash &key, merkle_hash *h);
+
+// Walk the keys of t in [rngmin, rngmax], adding each to tab and se
+// (either may be NULL), and return the key count and the XOR of the
+// key hashes, which summarize the set for a cheap equality check.
+void iblt_summarize (ptr<merkle_tree> t, const chordID &rngmin,
+		     const chordID &rngmax, iblt *tab, strata_estimator *se,
+		     u_int64_t *nkeys, merkle_hash *digest);
+
+#endif /* _IBLT_H_ */
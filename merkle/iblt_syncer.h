@@ -0,0 +1,56 @@
+#ifndef _IBLT_SYNCER_H_
+#define _IBLT_SYNCER_H_
+
+#include "merkle_syncer.h"
+
+class strata_estimator;
+
+// Finds the keys that differ between the local tree and a remote
+// node over a range using MERKLESYNC_RECONCILE.  Cost is a pass over
+// the local keys in the range plus communication proportional to the
+// number of differences; usually one round-trip, two if the first
+// table was too small.  Reports SYNC_TOOMANY if the difference is
+// too large to reconcile this way, in which case the caller should
+// fall back to merkle_syncer.
+class iblt_syncer : public virtual refcount {
+ public:
+  enum { SYNC_OK = 0, SYNC_ERR = 1, SYNC_TOOMANY = 2 };
+  enum { INITIAL_CELLS = 60, MAX_ROUNDS = 3 };
+
+ private:
+  ptr<bool> deleted;
+
+  uint vnode;
+  dhash_ctype ctype;
+  ptr<merkle_tree> ltree;
+  rpcfnc_t rpcfnc;
+  missingfnc_t missingfnc;
+
+  bigint rngmin;
+  bigint rngmax;
+
+  bool sync_done;
+  u_int32_t rounds;
+  u_int32_t ncells;
+  ptr<strata_estimator> lstrata;
+  cbi completecb;
+
+  void setdone (int status);
+  void doRPC (int procno, ptr<void> in, void *out, aclnt_cb cb);
+  void reconcile ();
+  void reconcile_cb (ptr<bool> deleted,
+		     ref<reconcile_arg> arg, ref<reconcile_res> res,
+		     clnt_stat err);
+
+ public:
+  iblt_syncer (uint vnode, dhash_ctype ctype,
+	       ptr<merkle_tree> ltree, rpcfnc_t rpcfnc,
+	       missingfnc_t missingfnc);
+  ~iblt_syncer ();
+
+  bool done () { return sync_done; }
+  u_int32_t nrounds () const { return rounds; }
+  void sync (bigint rngmin, bigint rngmax, cbi cb = cbi_null);
+};
+
+#endif /* _IBLT_SYNCER_H_ */
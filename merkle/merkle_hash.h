@@ -7,6 +7,15 @@
 
 #undef setbit
 
+// Bits of the key that pick a child at each level of a Merkle tree,
+// so a node has 1 << MERKLE_SLOT_BITS children.  Build everything
+// with the same value, e.g. -DMERKLE_SLOT_BITS=4 or 8 for 16- or
+// 256-way trees; at most 8.  Peers with different values can only
+// sync by comparing keys.
+#ifndef MERKLE_SLOT_BITS
+#define MERKLE_SLOT_BITS 6
+#endif /* MERKLE_SLOT_BITS */
+
 class merkle_hash {
 private:
   unsigned int getbit (unsigned int i) const;
@@ -14,9 +23,19 @@ private:
 
 public:
   enum {  size = sha1::hashsize };
-  enum {  NUM_SLOTS = 27 };
+  enum {  SLOT_BITS = MERKLE_SLOT_BITS };
+  enum {  FANOUT = 1 << SLOT_BITS };
+  enum {  NUM_SLOTS = (8 * size + SLOT_BITS - 1) / SLOT_BITS };
+  // The last slot may be narrower (4 bits with 6-bit slots).
+  enum {  LAST_SLOT_BITS = 8 * size - SLOT_BITS * (NUM_SLOTS - 1) };
   u_int8_t bytes[size];
 
+  // Bits below the slots of a node at depth: it covers
+  // 1 << suffix_bits (depth) keys.
+  static u_int suffix_bits (u_int depth) {
+    return (depth < NUM_SLOTS) ? 8 * size - SLOT_BITS * depth : 0;
+  }
+
   // XXX see template<class T> class zeroed_tmp_buf 
   // in sfs1/crypt/wmstr.h
   // operator T *() const { return base; }
@@ -26,16 +45,33 @@ public:
   merkle_hash (const bigint &id);
 
   void randomize ();
-  u_int read_slot (u_int slotno) const;
+  // Slot 0 is the most significant SLOT_BITS bits of the key.
+  u_int read_slot (u_int slotno) const {
+    if (8 % SLOT_BITS == 0) {
+      // Slots never straddle a byte.
+      u_int low = 8 * size - SLOT_BITS * (slotno + 1);
+      return (bytes[low / 8] >> (low % 8)) & (FANOUT - 1);
+    }
+    return read_slot_straddled (slotno);
+  }
+  u_int read_slot_straddled (u_int slotno) const;
   void write_slot (u_int slotno, u_int val);
   void clear_slot (int slotno);
   void clear_suffix (int slotno);
   int cmp (const merkle_hash &b) const;
   hash_t to_hash () const;
+  u_int32_t fingerprint (u_int word) const;
+
+  // Arithmetic modulo 2^160, for additive node hashes.
+  merkle_hash &operator+= (const merkle_hash &b);
+  merkle_hash &operator-= (const merkle_hash &b);
 
   operator bigint () const;
 };
 
+// A key's contribution to an additive node hash: SHA-1 of the key.
+merkle_hash merkle_key_digest (const merkle_hash &key);
+
 inline const strbuf &
 strbuf_cat (const strbuf &sb, const merkle_hash &a)
 {
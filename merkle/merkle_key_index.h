@@ -0,0 +1,54 @@
+#ifndef _MERKLE_KEY_INDEX_H_
+#define _MERKLE_KEY_INDEX_H_
+
+#include "merkle_hash.h"
+
+// An ordered set of 20-byte keys, kept in sorted blocks of at most
+// BLOCK keys each.  Costs one allocation per block rather than one
+// (plus a bigint) per key, and range scans read memory in order.
+class merkle_key_index {
+ public:
+  enum { BLOCK = 256 };
+
+  // A position in the index; invalidated by insert and remove.
+  struct cursor {
+    u_int b;
+    u_int i;
+  };
+
+ private:
+  struct block {
+    u_int n;
+    merkle_hash keys[BLOCK];
+    block () : n (0) {}
+  };
+  vec<block *> blocks;
+  size_t nkeys;
+
+  u_int find_block (const merkle_hash &k) const;
+  static u_int find_in_block (const block *b, const merkle_hash &k);
+  void insert_block (u_int at, block *b);
+  void remove_block (u_int at);
+
+ public:
+  merkle_key_index () : nkeys (0) {}
+  ~merkle_key_index () { clear (); }
+
+  size_t size () const { return nkeys; }
+  bool contains (const merkle_hash &k) const;
+  // Return false if k was already present (insert) or absent (remove).
+  bool insert (const merkle_hash &k);
+  bool remove (const merkle_hash &k);
+  void clear ();
+
+  // Cursor at the first key, or the first key >= k; false if none.
+  bool first (cursor *c) const;
+  bool lower_bound (const merkle_hash &k, cursor *c) const;
+  // Advance c; false at the end.
+  bool next (cursor *c) const;
+  const merkle_hash &at (const cursor &c) const {
+    return blocks[c.b]->keys[c.i];
+  }
+};
+
+#endif /* _MERKLE_KEY_INDEX_H_ */
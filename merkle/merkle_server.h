@@ -1,12 +1,25 @@
 #ifndef _MERKLE_SERVER_H_
 #define _MERKLE_SERVER_H_
 
+#include <async.h>
+#include <qhash.h>
+
 class merkle_tree;
 class user_args;
 class getkeys_arg;
 class getkeys_res;
 class sendnode_arg;
 class sendnode_res;
+class sendnode_compact_arg;
+class sendnode_compact_res;
+class getkeys_batch_arg;
+class getkeys_batch_res;
+class reconcile_arg;
+class reconcile_res;
+class getkeys_since_arg;
+class getkeys_since_res;
+class rangedigest_arg;
+class rangedigest_res;
 
 // One merkle_server runs for each node of the Chord ring.
 //  - i.e., one merkle_server per virtual node
@@ -19,13 +32,59 @@ class merkle_server {
   void dispatch (user_args *a);
   merkle_server (ptr<merkle_tree> ltree);
   void handle_get_keys (getkeys_arg *arg, getkeys_res *res);
+  void handle_get_keys_batch (getkeys_batch_arg *arg, getkeys_batch_res *res);
   void handle_send_node (sendnode_arg *arg, sendnode_res *res);
+  void handle_send_node_compact (sendnode_compact_arg *arg,
+      sendnode_compact_res *res);
+  void handle_reconcile (reconcile_arg *arg, reconcile_res *res);
+  void handle_get_keys_since (getkeys_since_arg *arg,
+      getkeys_since_res *res);
+  void handle_range_digest (rangedigest_arg *arg, rangedigest_res *res);
 
   static void handle_get_keys (ptr<merkle_tree> ltree,
       getkeys_arg *arg, getkeys_res *res);
+  static void handle_get_keys_batch (ptr<merkle_tree> ltree,
+      getkeys_batch_arg *arg, getkeys_batch_res *res);
   static void handle_send_node (ptr<merkle_tree> ltree,
       sendnode_arg *arg, sendnode_res *res);
+  static void handle_send_node_compact (ptr<merkle_tree> ltree,
+      sendnode_compact_arg *arg, sendnode_compact_res *res);
+  static void handle_reconcile (ptr<merkle_tree> ltree,
+      reconcile_arg *arg, reconcile_res *res);
+  static void handle_get_keys_since (ptr<merkle_tree> ltree,
+      getkeys_since_arg *arg, getkeys_since_res *res);
+  static void handle_range_digest (ptr<merkle_tree> ltree,
+      rangedigest_arg *arg, rangedigest_res *res);
 };
 
+// The snapshots one sync connection reads from, so that a session
+// sees one version of each local tree while writes go on.  A session
+// starts at RANGEDIGEST, or when a walk asks for the root.  Its
+// snapshot is released when the next session replaces it, at clear
+// (when the connection closes), or maxage seconds after it was taken.
+class merkle_sync_conn {
+  struct snap_t {
+    ptr<merkle_tree> base;	// keeps the snapshot's parent alive
+    ptr<merkle_tree> tree;
+    timecb_t *expire;
+  };
+  qhash<u_int64_t, snap_t> snaps;	// by (vnode, ctype)
+  const time_t maxage;
+
+  void drop (u_int64_t k);
+  void expire_cb (u_int64_t k);
+
+ public:
+  merkle_sync_conn (time_t maxage) : maxage (maxage) {}
+  ~merkle_sync_conn () { clear (); }
+
+  // The tree to answer procno, with argument arg, from: a snapshot
+  // of t if t can take one, else t.
+  ptr<merkle_tree> session_tree (u_int32_t vnode, u_int32_t ctype,
+				 ptr<merkle_tree> t,
+				 int procno, const void *arg);
+  void clear ();
+  size_t nsnapshots () const { return snaps.size (); }
+};
 
 #endif /* _MERKLE_SERVER_H_ */
@@ -6,6 +6,12 @@
 #include "merkle_sync_prot.h"
 #include <bigint.h>
 
+// A node's keys or child hashes travel in arrays bounded by
+// MERKLE_NODE_MAXENTRIES; refuse to build a tree shape (see
+// MERKLE_SLOT_BITS and MERKLE_LEAF_KEYS) that would overflow them.
+typedef char merkle_node_fits_rpc
+  [(merkle_node::MAX_ENTRIES <= MERKLE_NODE_MAXENTRIES) ? 1 : -1];
+
 template <class T1, class T2>
 struct pair {
   T1 first;
@@ -31,6 +37,13 @@ class merkle_syncer : public virtual refcount {
   str fatal_err;
   bool sync_done;
 
+  // Use MERKLESYNC_SENDNODE_COMPACT; cleared if the remote side
+  // does not support it or the fanout is over 64.
+  bool compact;
+  u_int32_t fpword;
+  // Keys per MERKLESYNC_GETKEYS_BATCH page; 0 to use GETKEYS.
+  u_int32_t keybatch;
+
   bigint local_rngmin;
   bigint local_rngmax;
 
@@ -47,6 +60,11 @@ class merkle_syncer : public virtual refcount {
   void sendnode_cb (ptr<bool> deleted,
                     ref<sendnode_arg> arg, ref<sendnode_res> res, 
 		    clnt_stat err);
+  void sendnode_compact_cb (ptr<bool> deleted, ref<merkle_rpc_node> lsnap,
+			    ref<sendnode_compact_arg> arg,
+			    ref<sendnode_compact_res> res,
+			    clnt_stat err);
+  void receive_node (merkle_rpc_node *rnode);
   void compare_nodes (bigint rngmin, bigint rngmax,
       merkle_node *lnode, merkle_rpc_node *rnode);
 
@@ -55,9 +73,14 @@ class merkle_syncer : public virtual refcount {
   void collect_keyranges (ptr<bool> deleted);
 
  public:
+  // Default GETKEYS_BATCH page size.  A full page needs the stream
+  // transport's packet limit raised from the default; maintd uses
+  // 1024*1025 on both ends.
+  enum { DEFAULT_KEYBATCH = 1024 };
+
   merkle_syncer (uint vnode, dhash_ctype ctype,
 		 ptr<merkle_tree> ltree, rpcfnc_t rpcfnc, 
-		 missingfnc_t missingfnc);
+		 missingfnc_t missingfnc, bool compact = true);
   ~merkle_syncer ();
 
   void dump ();
@@ -66,7 +89,11 @@ class merkle_syncer : public virtual refcount {
   void next (void);
 
   bool done () { return sync_done; }
+  void set_keybatch (u_int32_t n) { keybatch = n; }
   void sync (bigint rngmin, bigint rngmax, cbi cb = cbi_null);
+  // Compare every key in the range instead of walking the trees; for
+  // peers whose trees have a different shape.
+  void sync_keys (bigint rngmin, bigint rngmax, cbi cb = cbi_null);
   void sendnode (u_int depth, const merkle_hash &prefix);
 };
 
@@ -74,4 +101,24 @@ void
 format_rpcnode (merkle_tree *ltree, u_int depth, const merkle_hash &prefix,
 		merkle_node *node, merkle_rpc_node *rpcnode);
 
+// Helpers for MERKLESYNC_SENDNODE_COMPACT.
+void
+format_cnode (const merkle_rpc_node &full, u_int32_t fpword,
+	      merkle_rpc_cnode *cnode);
+bool
+format_rpcnode_compact (const merkle_rpc_node &full, u_int32_t fpword,
+			const merkle_rpc_cnode *remote,
+			sendnode_compact_resok *res);
+// Helpers for MERKLESYNC_GETKEYS_BATCH.
+void
+encode_keybatch (const vec<chordID> &keys, rpc_bytes<RPC_INFINITY> &out);
+bool
+decode_keybatch (const rpc_bytes<RPC_INFINITY> &in, u_int32_t nkeys,
+		 vec<chordID> &keys);
+
+bool
+expand_rpcnode_compact (const sendnode_compact_resok *res,
+			const merkle_rpc_node &lsnap,
+			merkle_rpc_node *rpcnode);
+
 #endif /* _MERKLE_SYNCER_H_ */
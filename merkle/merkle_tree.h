@@ -3,6 +3,53 @@
 
 #include <itree.h>
 #include "merkle_hash.h"
+#include "merkle_key_index.h"
+
+// How a node's hash summarizes the keys below it.  SHA1 hashes the
+// concatenation of a leaf's keys or of an internal node's child
+// hashes.  ADD is the sum, modulo 2^160, of merkle_key_digest of each
+// key below the node; an insert or remove then updates each node on
+// the path in O(1), without reading keys or siblings.  Trees can
+// only be compared node by node if they use the same mode.
+enum merkle_hash_mode {
+  MERKLE_HASH_SHA1 = 0,
+  MERKLE_HASH_ADD = 1
+};
+
+// Accumulates a node's hash, in key or child order.
+class merkle_hasher {
+  merkle_hash_mode mode;
+  sha1ctx sc;
+  merkle_hash sum;
+public:
+  merkle_hasher (merkle_hash_mode m = MERKLE_HASH_SHA1) : mode (m), sum (0) {}
+  void key (const merkle_hash &k) {
+    if (mode == MERKLE_HASH_ADD)
+      sum += merkle_key_digest (k);
+    else
+      sc.update (k.bytes, k.size);
+  }
+  void child (const merkle_hash &h) {
+    if (mode == MERKLE_HASH_ADD)
+      sum += h;
+    else
+      sc.update (h.bytes, h.size);
+  }
+  void final (merkle_hash *h) {
+    if (mode == MERKLE_HASH_ADD)
+      *h = sum;
+    else
+      sc.final (h->bytes);
+  }
+};
+
+// Keys a leaf holds before it splits into merkle_hash::FANOUT
+// children; an internal node with no more keys than this collapses
+// back into a leaf.  Like MERKLE_SLOT_BITS, a build-time choice that
+// peers must share to compare trees node by node.
+#ifndef MERKLE_LEAF_KEYS
+#define MERKLE_LEAF_KEYS merkle_hash::FANOUT
+#endif /* MERKLE_LEAF_KEYS */
 
 struct merkle_tree_stats {
   u_int32_t nodes_per_level[merkle_hash::NUM_SLOTS];
@@ -18,6 +65,11 @@ struct merkle_tree_stats {
 
 class merkle_node {
 public:
+  enum { FANOUT = merkle_hash::FANOUT };
+  enum { LEAF_KEYS = MERKLE_LEAF_KEYS };
+  // Hashes that go into a node's hash: its keys or its children's.
+  enum { MAX_ENTRIES = (LEAF_KEYS > FANOUT) ? LEAF_KEYS : FANOUT };
+
   u_int32_t count;
   merkle_hash hash;
 
@@ -25,9 +77,9 @@ public:
   virtual merkle_node *child (u_int i) = 0;
   virtual bool isleaf () const = 0;
   virtual bool leaf_is_full () const {
-    // XXX what about at the bottom level (count == 16)!!!!
+    // XXX what about at the bottom level (count == 1 << LAST_SLOT_BITS)!!!!
     assert (isleaf ());
-    return (count == 64);
+    return (count == LEAF_KEYS);
   }
   virtual void internal2leaf () = 0;
   virtual void leaf2internal () = 0;
@@ -45,13 +97,41 @@ struct merkle_key {
   merkle_key (merkle_hash id) : id (static_cast<bigint> (id)) {};
 };
 
+struct merkle_hash_input;
+
 class merkle_tree {
 protected:
   bool do_rehash;
+  merkle_hash_mode hash_mode;
 
   void _hash_tree (u_int depth, const merkle_hash &key, merkle_node *n, bool check);
+  void hash_input (u_int depth, const merkle_hash &prefix, merkle_node *n,
+      bool check, merkle_hash_input *in, merkle_hash_input **scratch);
+  void set_hash (u_int depth, const merkle_hash &prefix, merkle_node *n,
+      u_int64_t count, merkle_hash nhash, bool check);
   void rehash (u_int depth, const merkle_hash &key, merkle_node *n);
-  void stats_helper (uint depth, merkle_node *n);
+  void update_hash (u_int depth, const merkle_hash &key, merkle_node *n,
+      bool added);
+  void add_hash_tree (u_int depth, const merkle_hash &prefix, merkle_node *n,
+      bool check);
+  void stats_helper (uint depth, merkle_node *n, merkle_tree_stats *s);
+
+  // Keep stats current as the tree changes shape.  Sub-classes call
+  // these from insert and remove: stats_leaf_count when a leaf's
+  // count changes (returns true if the stats changed), stats_split
+  // when a leaf at depth becomes an internal node with nempty empty
+  // children, and stats_join for the reverse.
+  void stats_adjust (u_int depth, bool leaf, bool empty, int n);
+  void stats_reset ();
+  bool stats_leaf_count (u_int depth, u_int32_t oldcount, u_int32_t newcount);
+  void stats_split (u_int depth, u_int nempty);
+  void stats_join (u_int depth, u_int nempty, bool empty);
+  void range_digest_helper (u_int depth, const merkle_hash &prefix,
+      merkle_node *n, const chordID &rngmin, const chordID &rngmax,
+      sha1ctx &sc, u_int64_t &nkeys);
+  void range_digest_keys (u_int depth, const merkle_hash &prefix,
+      const vec<merkle_hash> &keys, const chordID &rngmin,
+      const chordID &rngmax, sha1ctx &sc, u_int64_t &nkeys);
 
   merkle_node *lookup (u_int *depth, u_int max_depth,
 		       const merkle_hash &key, merkle_node *n);
@@ -64,9 +144,11 @@ public:
   enum { MAX_DEPTH = merkle_hash::NUM_SLOTS }; // XXX off by one? or two?
   merkle_tree_stats stats;
 
-  merkle_tree ();
+  merkle_tree (merkle_hash_mode mode = MERKLE_HASH_SHA1);
   virtual ~merkle_tree ();
 
+  merkle_hash_mode get_hash_mode () const { return hash_mode; }
+
   // Sub-classes must implement the following methods
   virtual merkle_node *get_root () = 0;
   virtual int insert (merkle_hash &key) = 0;
@@ -97,6 +179,19 @@ public:
 
   virtual vec<chordID> database_get_IDs (u_int depth, const merkle_hash &prefix);
 
+  // Append to keys the keys in [min, max] that were inserted at or
+  // after time since (seconds since the epoch).  Returns false if
+  // the tree does not keep insertion history back to since, or if
+  // more than n keys qualify.
+  virtual bool get_keys_since (u_int32_t since, const chordID &min,
+      const chordID &max, u_int n, vec<chordID> &keys) { return false; }
+
+  // A read-only view of the tree as it is now, unaffected by later
+  // writes, so that a sync session sees a single version of the
+  // tree.  It must not outlive this tree.  Returns NULL if the tree
+  // cannot take one cheaply; callers then read the tree itself.
+  virtual ptr<merkle_tree> snapshot () { return NULL; }
+
   virtual void check_invariants ();
 
   // Sub-classes should not override the following methods
@@ -115,8 +210,23 @@ public:
   void set_rehash_on_modification (bool enable);
   void hash_tree ();
 
+  // Node counts by level, maintained as the tree changes; O(1).
+  // Sub-classes whose stats another process may change override this.
+  virtual merkle_tree_stats get_stats () { return stats; }
+  // Count the nodes by walking the whole tree.
+  merkle_tree_stats count_stats ();
+
   void dump ();
+  // Print get_stats () and the leaf depths.
   void compute_stats ();
+
+  // Summarize the keys in [rngmin, rngmax] using the hashes of the
+  // subtrees that lie wholly in the range.  Leaves that straddle an
+  // end are digested as if split into per-slot children, so the
+  // result depends only on the keys in the range: peers that agree
+  // there get equal digests whatever they hold outside it.
+  merkle_hash range_digest (const chordID &rngmin, const chordID &rngmax,
+      u_int64_t *nkeys = NULL);
 };
 
 class merkle_node_mem;
@@ -124,17 +234,29 @@ class merkle_node_mem;
 class merkle_tree_mem : public merkle_tree {
 protected:
   merkle_node_mem *root;
-  itree<chordID, merkle_key, &merkle_key::id, &merkle_key::ik> keylist;
+  merkle_key_index keylist;
+  // Insertion history, in time order; may name keys since removed.
+  // Entries older than HIST_MAXAGE are dropped, and histstart is then
+  // the earliest time the history is complete from.  Once removals
+  // leave more dead entries than live ones, the history is compacted.
+  enum { HIST_MAXAGE = 2 * 3600 };
+  vec<u_int32_t> histtime;
+  vec<merkle_hash> histkey;
+  u_int32_t histstart;
+  u_int histdead;
+
+  void hist_prune ();
+  void hist_compact ();
 
   void count_blocks (u_int depth, const merkle_hash &key,
-		     array<u_int64_t, 64> &nblocks);
+		     array<u_int64_t, merkle_node::FANOUT> &nblocks);
   void leaf2internal (u_int depth, const merkle_hash &key, merkle_node *n);
 
   virtual int remove (u_int depth, merkle_hash &key, merkle_node *n);
   virtual int insert (u_int depth, merkle_hash &key, merkle_node *n);
 
 public:
-  merkle_tree_mem ();
+  merkle_tree_mem (merkle_hash_mode mode = MERKLE_HASH_SHA1);
   virtual ~merkle_tree_mem ();
 
   virtual merkle_node *get_root ();
@@ -142,12 +264,14 @@ public:
   virtual int insert (merkle_hash &key);
   virtual int remove (merkle_hash &key);
   virtual bool key_exists (chordID key) {
-    return keylist[key] != NULL;
+    return keylist.contains (merkle_hash (key));
   }
   virtual vec<merkle_hash> database_get_keys (u_int depth,
       const merkle_hash &prefix);
   void get_keyrange_nowrap (const chordID &min,
       const chordID &max, u_int n, vec<chordID> &keys);
+  bool get_keys_since (u_int32_t since, const chordID &min,
+      const chordID &max, u_int n, vec<chordID> &keys);
 
   virtual merkle_node *lookup_exact (u_int depth, const merkle_hash &key);
   virtual merkle_node *lookup (u_int depth, const merkle_hash &key);
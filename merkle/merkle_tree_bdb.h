@@ -9,9 +9,20 @@ class merkle_tree_bdb : public merkle_tree
   DB_ENV *dbe;
   DB *nodedb;
   DB *keydb;
+  DB *timedb; // (insertion time, key); NULL if not kept.
+  // For a snapshot, the DB_TXN_SNAPSHOT transaction that all reads
+  // go through; the handles above belong to the parent tree.
+  DB_TXN *snap;
+
+  merkle_tree_bdb (merkle_tree_bdb *parent, DB_TXN *snap);
 
   void warner (const char *method, const char *desc, int r) const;
 
+  // Reads without a transaction of their own use the snapshot's.
+  DB_TXN *reader (DB_TXN *t) const { return t ? t : snap; }
+  void begin_read (DB_TXN **t);
+  void end_read (DB_TXN *t);
+
   // Database initialization
   int init_db (bool ro);
 
@@ -22,6 +33,10 @@ class merkle_tree_bdb : public merkle_tree
   bool check_key (const merkle_hash &key, DB_TXN *t = NULL);
   int insert_key (const merkle_hash &key, DB_TXN *t = NULL);
   int remove_key (const merkle_hash &key, DB_TXN *t = NULL);
+  u_int32_t get_histstart (DB_TXN *t = NULL);
+  // The stats record; read_stats returns false if there is none.
+  bool read_stats (DB_TXN *t = NULL);
+  int write_stats (DB_TXN *t = NULL);
 
   void verify_subtree (merkle_node_bdb *n, DB_TXN *t);
 
@@ -38,8 +53,11 @@ class merkle_tree_bdb : public merkle_tree
   }
 
 public:
-  merkle_tree_bdb (const char *path, bool join, bool ro);
-  merkle_tree_bdb (DB_ENV *dbe, bool ro);
+  // mode only applies to a new tree; an existing tree keeps its own.
+  merkle_tree_bdb (const char *path, bool join, bool ro,
+      merkle_hash_mode mode = MERKLE_HASH_SHA1);
+  merkle_tree_bdb (DB_ENV *dbe, bool ro,
+      merkle_hash_mode mode = MERKLE_HASH_SHA1);
   virtual ~merkle_tree_bdb ();
 
   static bool tree_exists (const char *path);
@@ -61,6 +79,8 @@ public:
       const merkle_hash &prefix);
   void get_keyrange_nowrap (const chordID &min,
       const chordID &max, u_int n, vec<chordID> &keys);
+  bool get_keys_since (u_int32_t since, const chordID &min,
+      const chordID &max, u_int n, vec<chordID> &keys);
 
   using merkle_tree::lookup;
   merkle_node *lookup_exact (u_int depth, const merkle_hash &key);
@@ -71,6 +91,8 @@ public:
   // Sub-classes may override the following methods
   void lookup_release (merkle_node *n);
   void sync (bool reopen = true);
+  ptr<merkle_tree> snapshot ();
+  merkle_tree_stats get_stats ();
   void check_invariants ();
 };
 
@@ -80,7 +102,9 @@ struct merkle_node_bdb : public merkle_node
   u_int32_t depth;
 
   bool leaf;
-  merkle_hash _child_hash[64];
+  u_int slot_bits;		// as read from disk
+  merkle_hash_mode mode;	// as read from disk
+  merkle_hash _child_hash[FANOUT];
 
   merkle_tree_bdb *tree;
 
@@ -88,11 +112,11 @@ struct merkle_node_bdb : public merkle_node
 
   // Must make sure to update this if parent gets more fields.
   static const size_t marshaled_size =
-    2 * sizeof (u_int32_t) + 4 /* bool */ + (2 + 64) * merkle_hash::size;
+    2 * sizeof (u_int32_t) + 4 /* bool */ + (2 + FANOUT) * merkle_hash::size;
 
   // Interface methods
   merkle_hash child_hash (u_int i) {
-    assert (i < 64);
+    assert (i < FANOUT);
     return _child_hash[i];
   }
   merkle_node *child (u_int i);
@@ -105,7 +129,9 @@ struct merkle_node_bdb : public merkle_node
 
   operator str () const;
 
-  merkle_node_bdb () : merkle_node (), depth (0), leaf (true), tree (NULL) {}
+  merkle_node_bdb () : merkle_node (), depth (0), leaf (true),
+    slot_bits (merkle_hash::SLOT_BITS), mode (MERKLE_HASH_SHA1),
+    tree (NULL) {}
   merkle_node_bdb (const unsigned char *buf, size_t sz, merkle_tree_bdb *t);
   ~merkle_node_bdb ();
 };
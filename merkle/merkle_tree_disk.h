@@ -19,16 +19,17 @@ struct merkle_index_metadata {
   u_int32_t num_internal_free;
   u_int32_t next_leaf;
   u_int32_t next_internal;
+  u_int32_t epoch;	// bumped whenever the writer changes the tree
 };
 
 struct merkle_internal_node {
-  merkle_char_key hashes[64];
-  u_int32_t child_pointers[64];
+  merkle_char_key hashes[merkle_node::FANOUT];
+  u_int32_t child_pointers[merkle_node::FANOUT];
   u_int32_t key_count;
 };
 
 struct merkle_leaf_node {
-  merkle_char_key keys[64];
+  merkle_char_key keys[merkle_node::LEAF_KEYS];
   u_int32_t key_count;
 };
 
@@ -37,20 +38,60 @@ struct merkle_hash_id {
   chordID id;
 };
 
+// A file of fixed-size blocks, memory-mapped.  Writers grow the
+// file GROW_BLOCKS blocks at a time, which moves the mapping; readers
+// map the file as it is when opened.
+class merkle_disk_file {
+  const str _name;
+  const size_t _blocksize;
+  const bool _writer;
+  int _fd;
+  char *_base;
+  size_t _mapsize;
+
+  void map (size_t size);
+  void unmap ();
+
+ public:
+  enum { GROW_BLOCKS = 1024 };
+
+  u_int32_t nblocks () const { return _mapsize / _blocksize; }
+  // Pointer to block n, growing the file if need be (writers only).
+  char *block (u_int32_t n);
+  // Pointer to block n, or NULL if it is past the end of the file.
+  const char *block (u_int32_t n) const;
+  void flush ();
+
+  merkle_disk_file (str name, size_t blocksize, bool writer);
+  ~merkle_disk_file ();
+};
+
+// Nodes of a writer's tree are decoded into hashes/children/keylist
+// so that they survive the file growing under them.  Nodes of a
+// reader's tree refer to their mapped block in place and must not be
+// held across merkle_tree_disk::sync.
 class merkle_node_disk : public merkle_node {
  private:
-  array<merkle_hash_id, 64> *hashes;
-  array<u_int32_t, 64> *children;
+  array<merkle_hash_id, merkle_node::FANOUT> *hashes;
+  array<u_int32_t, merkle_node::FANOUT> *children;
 
-  FILE *_internal;
-  FILE *_leaf;
+  merkle_disk_file *_internal;
+  merkle_disk_file *_leaf;
   MERKLE_DISK_TYPE _type;
   u_int32_t _block_no;
+  const bool _inplace;
+  const merkle_internal_node *_iblock;
+  const merkle_leaf_node *_lblock;
   vec<merkle_node_disk *> to_delete;
 
  public:
+  // Leaf keys of a writer's node.
   itree<chordID, merkle_key, &merkle_key::id, &merkle_key::ik> keylist;
 
+  // Leaf keys in increasing order, for either kind of node.
+  void leaf_keys (vec<chordID> &keys) const;
+  bool has_key (const chordID &key) const;
+
   merkle_hash child_hash (u_int i);
   u_int32_t child_ptr (u_int i);
   merkle_node *child (u_int i);
@@ -66,8 +107,8 @@ class merkle_node_disk : public merkle_node {
   void rehash ();
   void dump (u_int depth);
 
-  merkle_node_disk (FILE *internal, FILE *leaf,
-		    MERKLE_DISK_TYPE type, u_int32_t block_no);
+  merkle_node_disk (merkle_disk_file *internal, merkle_disk_file *leaf,
+		    MERKLE_DISK_TYPE type, u_int32_t block_no, bool inplace);
   ~merkle_node_disk ();
 };
 
@@ -78,14 +119,15 @@ private:
   str _leaf_name;
 
   merkle_index_metadata _md;
+  merkle_hash _root_hash;	// readers only
   vec<u_int32_t> _free_leafs;
   vec<u_int32_t> _free_internals;
   vec<u_int32_t> _future_free_leafs;
   vec<u_int32_t> _future_free_internals;
 
-  FILE *_index;
-  FILE *_internal;
-  FILE *_leaf;
+  FILE *_index;		// writers only
+  merkle_disk_file *_internal;
+  merkle_disk_file *_leaf;
 
   bool _writer;
 
@@ -93,9 +135,12 @@ private:
   int insert (u_int depth, merkle_hash &key, merkle_node *n);
   merkle_node *make_node (u_int32_t pointer);
   merkle_node *make_node (u_int32_t block_no, MERKLE_DISK_TYPE type);
+  merkle_node *copy_node (merkle_node *n);
   u_int32_t alloc_free_block (MERKLE_DISK_TYPE type);
   void free_block (u_int32_t block_no, MERKLE_DISK_TYPE type);
   void write_metadata ();
+  // Also reads stats; *havestats is false if the index predates them.
+  bool read_metadata (FILE *f, bool freelist, bool *havestats);
   void leaf2internal (uint depth, merkle_node_disk *n);
   void switch_root (merkle_node_disk *n);
 
@@ -121,6 +166,7 @@ public:
   void lookup_release (merkle_node *n);
   int remove (merkle_hash &key);
   void sync (bool reopen);
+  ptr<merkle_tree> snapshot ();
 };
 
 #endif /* _MERKLE_TREE_DISK_H_ */
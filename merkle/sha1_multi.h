@@ -0,0 +1,16 @@
+#ifndef _SHA1_MULTI_H_
+#define _SHA1_MULTI_H_
+
+#include "async.h"
+
+// Multi-buffer SHA-1: hashes several independent messages at once,
+// SHA1_LANES at a time, one message per SIMD lane (SSE2 where the
+// compiler offers it, plain 32-bit lanes otherwise).  Worthwhile when
+// the messages are of similar length, such as the inputs to the
+// hashes of sibling merkle nodes.  Output is identical to sha1ctx.
+enum { SHA1_LANES = 4 };
+
+void sha1_multi (u_int n, const u_int8_t *const *msg, const size_t *len,
+		 u_int8_t (*digest)[20]);
+
+#endif /* _SHA1_MULTI_H_ */
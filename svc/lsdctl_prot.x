@@ -32,6 +32,11 @@ struct lsdctl_rpcstat {
   u_int64_t nreply;
   u_int64_t reply_bytes;
   u_int64_t latency_ewma;
+  u_int64_t nlatency;		/* service time samples */
+  u_int64_t latency_p50;	/* usec */
+  u_int64_t latency_p90;
+  u_int64_t latency_p99;
+  u_int64_t latency_max;
 };
 
 struct lsdctl_rpcstatlist {
@@ -111,5 +116,10 @@ program LSDCTL_PROG {
 		lsdctl_rpcmstats
 		LSDCTL_GETRPCMSTATS (void) = 10;
 		/** Return exactly rpcm's stats string. */
+
+		lsdctl_dhashstats
+		LSDCTL_GETTREESTATS (lsdctl_getdhashstats_arg) = 11;
+		/** Node counts of the Merkle trees on vnode i (all if < 0),
+		 *  summed over vnodes.  Served by maintd. */
 	} = 1;
 } = 344500;
@@ -4,9 +4,15 @@
 
 enum merkle_stat {
   MERKLE_OK = 0,
-  MERKLE_ERR = 1
+  MERKLE_ERR = 1,
+  MERKLE_DECODEFAIL = 2,
+  MERKLE_NOHISTORY = 3
 };
 
+/* Bounds the keys of a leaf or the children of an internal node for
+ * any tree shape a peer may be built with (see MERKLE_SLOT_BITS). */
+const MERKLE_NODE_MAXENTRIES = 256;
+
 struct merkle_rpc_node {
   u_int32_t depth;
   merkle_hash prefix;	
@@ -15,7 +21,7 @@ struct merkle_rpc_node {
   u_int64_t count;
   merkle_hash hash;
 
-  merkle_hash child_hash<64>;
+  merkle_hash child_hash<MERKLE_NODE_MAXENTRIES>;
 };
 
 struct syncdest_t {
@@ -45,6 +51,38 @@ union getkeys_res switch (merkle_stat status) {
    void;
 };
 
+/***********************************************************/
+/* GETKEYS_BATCH */
+
+/* Servers clamp maxkeys to this.  A key costs at most 21 bytes in a
+ * page, so a full page still fits the default 64 KB axprt_stream
+ * packet limit of a peer that has not raised it. */
+const MERKLE_GETKEYS_BATCH_MAX = 3072;
+
+struct getkeys_batch_arg {
+  u_int32_t vnode;
+  dhash_ctype ctype;
+  bigint rngmin;
+  bigint rngmax;
+  u_int32_t maxkeys;
+};
+
+/* keys holds nkeys 20-byte big-endian keys in increasing clockwise
+ * order, each encoded as one byte giving the number of leading bytes
+ * shared with the previous key, followed by the remaining bytes. */
+struct getkeys_batch_resok {
+  u_int32_t nkeys;
+  opaque keys<>;
+  bool morekeys;
+};
+
+union getkeys_batch_res switch (merkle_stat status) {
+ case MERKLE_OK:
+   getkeys_batch_resok resok;
+ default:
+   void;
+};
+
 
 /***********************************************************/
 /* SENDNODE */
@@ -68,7 +106,162 @@ union sendnode_res switch (merkle_stat status) {
    void;
 };
 
+/***********************************************************/
+/* SENDNODE_COMPACT */
+
+/* Compact form of merkle_rpc_node.  Empty children are elided
+ * using a bitmap; non-empty children are summarized by a 32-bit
+ * fingerprint (word fpword of the child hash).  Leaf keys are
+ * not sent, since the server only needs depth and prefix.  The
+ * bitmaps limit this to trees of fanout 64 or less. */
+struct merkle_rpc_cnode {
+  u_int32_t depth;
+  merkle_hash prefix;
+
+  bool isleaf;
+  u_int64_t count;
+  merkle_hash hash;
+
+  u_int64_t nonempty;		/* bit i set if child i is non-empty */
+  u_int32_t fingerprint<64>;	/* one per bit set in nonempty */
+};
+
+struct sendnode_compact_arg {
+  u_int32_t vnode;
+  dhash_ctype ctype;
+  bigint rngmin;
+  bigint rngmax;
+  u_int32_t fpword;
+  merkle_rpc_cnode node;
+};
+
+struct sendnode_compact_resok {
+  u_int32_t depth;
+  merkle_hash prefix;
+
+  bool isleaf;
+  u_int64_t count;
+  merkle_hash hash;
+
+  u_int64_t nonempty;		/* bit i set if child i is non-empty */
+  u_int64_t differ;		/* bit i set if child i may differ */
+  /* Leaves: all keys.  Internal nodes: the full hash of each child
+   * that is both non-empty and in differ, in slot order. */
+  merkle_hash child_hash<MERKLE_NODE_MAXENTRIES>;
+};
+
+union sendnode_compact_res switch (merkle_stat status) {
+ case MERKLE_OK:
+   sendnode_compact_resok resok;
+ default:
+   void;
+};
+
+/***********************************************************/
+/* RECONCILE */
+
+/* Set reconciliation with invertible Bloom lookup tables.  The
+ * client sends an IBLT of its keys in [rngmin, rngmax]; the server
+ * subtracts its own and tries to decode the difference.  If that
+ * fails, the server returns a strata estimator so that the client
+ * can size the next attempt. */
+const MERKLE_IBLT_MAXCELLS = 24576;
 
+struct iblt_cell {
+  int32_t count;
+  merkle_hash keysum;
+  u_int32_t hashsum;
+};
+
+struct reconcile_arg {
+  u_int32_t vnode;
+  dhash_ctype ctype;
+  bigint rngmin;
+  bigint rngmax;
+  u_int64_t nkeys;	/* client keys in range */
+  merkle_hash digest;	/* XOR of the key hashes in range */
+  iblt_cell cells<>;
+};
+
+struct reconcile_resok {
+  merkle_hash remote_only<>;	/* server has, client lacks */
+  merkle_hash local_only<>;	/* client has, server lacks */
+};
+
+union reconcile_res switch (merkle_stat status) {
+ case MERKLE_OK:
+   reconcile_resok resok;
+ case MERKLE_DECODEFAIL:
+   iblt_cell strata<>;
+ default:
+   void;
+};
+
+/***********************************************************/
+/* GETKEYS_SINCE */
+
+/* Keys in [rngmin, rngmax] that the server inserted at or after
+ * since, by the server's clock.  A since in the future returns no
+ * keys, which lets a client learn the server's clock.  If the
+ * server has no insertion history back to since, or more than
+ * MERKLE_GETKEYS_SINCE_MAX keys qualify, it returns
+ * MERKLE_NOHISTORY and the client should fall back to SENDNODE. */
+const MERKLE_GETKEYS_SINCE_MAX = 8192;
+
+struct getkeys_since_arg {
+  u_int32_t vnode;
+  dhash_ctype ctype;
+  bigint rngmin;
+  bigint rngmax;
+  u_int32_t since;
+};
+
+struct getkeys_since_resok {
+  bigint keys<>;
+  u_int32_t now;	/* since for the next request */
+};
+
+union getkeys_since_res switch (merkle_stat status) {
+ case MERKLE_OK:
+   getkeys_since_resok resok;
+ case MERKLE_NOHISTORY:
+   u_int32_t now;
+ default:
+   void;
+};
+
+/***********************************************************/
+/* RANGEDIGEST */
+
+/* merkle_tree::range_digest over [rngmin, rngmax]; lets a client
+ * skip the sync when nothing in the range differs.  Each side also
+ * names its tree's merkle_hash_mode and shape (bits per slot and
+ * keys per leaf): node hashes, and so SENDNODE, are only comparable
+ * if both agree. */
+struct rangedigest_arg {
+  u_int32_t vnode;
+  dhash_ctype ctype;
+  bigint rngmin;
+  bigint rngmax;
+  u_int32_t hashmode;
+  u_int32_t slotbits;
+  u_int32_t leafkeys;
+};
+
+struct rangedigest_resok {
+  merkle_hash digest;
+  u_int64_t nkeys;
+  u_int32_t hashmode;
+  u_int32_t slotbits;
+  u_int32_t leafkeys;
+};
+
+union rangedigest_res switch (merkle_stat status) {
+ case MERKLE_OK:
+   rangedigest_resok resok;
+ default:
+   void;
+};
 
 program MERKLESYNC_PROGRAM {
 	version MERKLESYNC_VERSION {
@@ -77,5 +270,20 @@ program MERKLESYNC_PROGRAM {
 
                 getkeys_res
                 MERKLESYNC_GETKEYS (getkeys_arg) = 6;
+
+	        sendnode_compact_res
+		MERKLESYNC_SENDNODE_COMPACT (sendnode_compact_arg) = 7;
+
+                getkeys_batch_res
+                MERKLESYNC_GETKEYS_BATCH (getkeys_batch_arg) = 8;
+
+                reconcile_res
+                MERKLESYNC_RECONCILE (reconcile_arg) = 9;
+
+                getkeys_since_res
+                MERKLESYNC_GETKEYS_SINCE (getkeys_since_arg) = 10;
+
+                rangedigest_res
+                MERKLESYNC_RANGEDIGEST (rangedigest_arg) = 11;
 	} = 1;
 } = 344450;
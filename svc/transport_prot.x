@@ -32,6 +32,17 @@ union dorpc_res switch (rpcstat status) {
    void;
 };
 
+/* Several small calls to one host in one datagram.  The reply comes
+ * when every call has been answered, so only procedures that answer
+ * at once are batched. */
+struct dorpc_batch_arg {
+  dorpc_arg calls<>;
+};
+
+struct dorpc_batch_res {
+  dorpc_res results<>;
+};
+
 program TRANSPORT_PROGRAM {
   version TRANSPORT_VERSION {
     void
@@ -39,5 +50,8 @@ program TRANSPORT_PROGRAM {
     
     dorpc_res
     TRANSPORTPROC_DORPC (dorpc_arg) = 1;
+
+    dorpc_batch_res
+    TRANSPORTPROC_DORPC_BATCH (dorpc_batch_arg) = 2;
   } = 1;
 } = 344451;
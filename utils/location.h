@@ -42,6 +42,9 @@ class location {
   Coord coords () { return coords_; };
   float distance () const { return a_lat_; };
   float a_var () const { return a_var_; };
+  // Measured latency once we have talked to it; until then, what the
+  // coordinates predict from `from'.
+  float predicted_rtt (const Coord &from) const;
   bool alive () const { return alive_; };
   time_t dead_time () const { return dead_time_; }
   const sockaddr_in &saddr () const { return saddr_; };
@@ -109,6 +109,8 @@ class locationtable {
   //iterating over locations
   ptr<location> first_loc ();
   ptr<location> next_loc (const chordID &n);
+  // Wraps around; NULL only if n is the sole entry.
+  ptr<location> prev_loc (const chordID &n);
   
 #if 0    
   //average stats